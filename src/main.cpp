@@ -5,6 +5,7 @@
 #include <chrono>
 #include <condition_variable>
 #include <exception>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <memory>
@@ -34,7 +35,7 @@ using clock = std::chrono::steady_clock;
 
 void usage() {
   std::ostringstream oss;
-  oss << "usage: ntsb a|as|n|ns connections messages bytes address port\n\n"
+  oss << "usage: ntsb a|as|n|ns connections messages bytes address port report\n\n"
     "  a|n          : server backend: asio | net\n"
     "  a|n          : client backend: asio | net\n"
     "  connections  : number of simultaneous connections  (default: 20)\n"
@@ -42,17 +43,53 @@ void usage() {
     "  bytes        : message size in bytes (default: 4096)\n"
     "  address      : client/server address (default: 127.0.0.1)\n"
     "  service      : client/server service (default: 9000)\n"
+    "  report       : CSV report file name prefix (default: none)\n"
     "\n"
     "Possible server/client combinations:\n"
     "  a  a,  a  n,  n  a,  n  n\n";
   throw std::runtime_error(oss.str());
 }
 
+// Width of a single time series window in the CSV report.
+constexpr auto timeline_interval = 100ms;
+
 struct message {
   clock::time_point send;
   clock::time_point recv;
 };
 
+// Per-thread client statistics. Each slot is only written by the thread that owns it.
+struct alignas(64) thread_stats {
+  std::size_t handlers = 0;
+};
+
+inline thread_local thread_stats* current_thread_stats = nullptr;
+
+// Counts a completion handler invocation on the current client thread.
+inline void count_handler() noexcept {
+  if (current_thread_stats) {
+    current_thread_stats->handlers++;
+  }
+}
+
+// Returns the p-th percentile (0.0 - 1.0) of the given values. Reorders the values.
+template <typename T>
+T percentile(std::vector<T>& values, double p) {
+  const auto index = static_cast<std::size_t>(p * static_cast<double>(values.size() - 1));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+// Opens a CSV report file for writing.
+std::ofstream open_report(const std::string& filename) {
+  std::ofstream file(filename, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("could not open report file: " + filename);
+  }
+  file << std::fixed;
+  return file;
+}
+
 template <typename Session>
 class session : public Session, public std::enable_shared_from_this<session<Session>> {
 public:
@@ -219,6 +256,7 @@ private:
     }
     messages_[index].send = clock::now();
     Client::send(message_data_, message_size_, [this, index](const std::error_code& ec, std::size_t) {
+      count_handler();
       if (ec) {
         throw std::system_error(ec, "client send");
       }
@@ -233,6 +271,7 @@ private:
       return;
     }
     Client::recv(buffer_.data(), buffer_.size(), [this, index, pos](const std::error_code& ec, std::size_t size) {
+      count_handler();
       if (ec) {
         throw std::system_error(ec, "client recv");
       }
@@ -261,7 +300,8 @@ private:
 };
 
 template <typename Server, typename Client>
-void test(std::string_view address, std::string_view service, std::size_t connections, std::size_t messages, std::size_t bytes) {
+void test(std::string_view address, std::string_view service, std::size_t connections, std::size_t messages, std::size_t bytes,
+  std::string_view report) {
   // Chose number of threads.
   const auto threads = std::thread::hardware_concurrency();
 
@@ -301,9 +341,11 @@ void test(std::string_view address, std::string_view service, std::size_t connec
   pool.resize(std::max(threads, 2u) - 1);
   std::size_t thread_max = pool.size();
   std::size_t thread_cur = 0;
+  std::vector<thread_stats> stats(pool.size());
 
   for (std::size_t i = 0; i < pool.size(); i++) {
-    pool[i] = std::thread([&]() {
+    pool[i] = std::thread([&, i]() {
+      current_thread_stats = &stats[i];
       {
         // Wait for all client threads to fully initialize before sending messages.
         std::unique_lock<std::mutex> lock(mutex);
@@ -391,6 +433,17 @@ void test(std::string_view address, std::string_view service, std::size_t connec
   const auto total_mibps = total_mib / total_seconds;
 
   using milliseconds = std::chrono::duration<double, std::milli>;
+  using seconds = std::chrono::duration<double>;
+
+  // Calculate per-connection throughput and Jain's fairness index.
+  const auto connection_mib = messages * bytes / 1024.0 / 1024.0;
+  std::vector<double> connection_mibps;
+  for (auto& e : clients) {
+    connection_mibps.push_back(connection_mib / std::chrono::duration_cast<seconds>(e->end() - e->beg()).count());
+  }
+  const auto mibps_sum = std::accumulate(connection_mibps.begin(), connection_mibps.end(), 0.0);
+  const auto mibps_sum_squares = std::inner_product(connection_mibps.begin(), connection_mibps.end(), connection_mibps.begin(), 0.0);
+  const auto jain = mibps_sum * mibps_sum / (connection_mibps.size() * mibps_sum_squares);
 
   std::cout << std::fixed
     << std::setprecision(1) << total_mib << " MiB in "
@@ -399,8 +452,73 @@ void test(std::string_view address, std::string_view service, std::size_t connec
     << "min: " << std::setprecision(3) << std::chrono::duration_cast<milliseconds>(min).count() << " ms, "
     << "max: " << std::setprecision(3) << std::chrono::duration_cast<milliseconds>(max).count() << " ms, "
     << "avg: " << std::setprecision(3) << std::chrono::duration_cast<milliseconds>(avg).count() << " ms, "
-    << "med: " << std::setprecision(3) << std::chrono::duration_cast<milliseconds>(med).count() << " ms"
+    << "med: " << std::setprecision(3) << std::chrono::duration_cast<milliseconds>(med).count() << " ms, "
+    << "jain: " << std::setprecision(3) << jain
     << std::endl;
+
+  if (report.empty()) {
+    return;
+  }
+
+  // Write per-connection throughput.
+  {
+    auto file = open_report(std::string(report) + ".connections.csv");
+    file << "connection,seconds,mibps\n";
+    for (std::size_t i = 0; i < clients.size(); i++) {
+      const auto& e = clients[i];
+      file << i << ','
+        << std::setprecision(6) << std::chrono::duration_cast<seconds>(e->end() - e->beg()).count() << ','
+        << std::setprecision(3) << connection_mibps[i] << '\n';
+    }
+  }
+
+  // Write per-thread handler counts.
+  {
+    const auto handlers = std::accumulate(stats.begin(), stats.end(), std::size_t(0), [](std::size_t sum, const thread_stats& e) {
+      return sum + e.handlers;
+    });
+    auto file = open_report(std::string(report) + ".threads.csv");
+    file << "thread,handlers,share\n";
+    for (std::size_t i = 0; i < stats.size(); i++) {
+      file << i << ',' << stats[i].handlers << ','
+        << std::setprecision(3) << (handlers ? static_cast<double>(stats[i].handlers) / handlers : 0.0) << '\n';
+    }
+  }
+
+  // Write throughput and latency percentiles of messages received in each timeline interval.
+  {
+    const auto windows = static_cast<std::size_t>((end - beg) / timeline_interval) + 1;
+    std::vector<std::vector<std::chrono::nanoseconds>> timeline(windows);
+    for (auto& e : clients) {
+      for (auto& message : e->messages()) {
+        const auto window = std::min(static_cast<std::size_t>((message.recv - beg) / timeline_interval), windows - 1);
+        timeline[window].emplace_back(message.recv - message.send);
+      }
+    }
+    auto file = open_report(std::string(report) + ".timeline.csv");
+    file << "time_ms,messages,mibps,p50_ms,p99_ms,max_ms\n";
+    for (std::size_t i = 0; i < windows; i++) {
+      auto& durations = timeline[i];
+      const auto window_beg = timeline_interval * i;
+      const auto window_end = std::min<clock::duration>(window_beg + timeline_interval, end - beg);
+      const auto window_seconds = std::chrono::duration_cast<seconds>(window_end - window_beg).count();
+      const auto time = std::chrono::duration_cast<milliseconds>(window_beg).count();
+      const auto mibps = window_seconds > 0 ? durations.size() * bytes / 1024.0 / 1024.0 / window_seconds : 0.0;
+      auto p50 = 0ns;
+      auto p99 = 0ns;
+      auto max = 0ns;
+      if (!durations.empty()) {
+        max = *std::max_element(durations.begin(), durations.end());
+        p99 = percentile(durations, 0.99);
+        p50 = percentile(durations, 0.50);
+      }
+      file << std::setprecision(0) << time << ',' << durations.size() << ','
+        << std::setprecision(1) << mibps << ','
+        << std::setprecision(3) << std::chrono::duration_cast<milliseconds>(p50).count() << ','
+        << std::setprecision(3) << std::chrono::duration_cast<milliseconds>(p99).count() << ','
+        << std::setprecision(3) << std::chrono::duration_cast<milliseconds>(max).count() << '\n';
+    }
+  }
 }
 
 }  // namespace test
@@ -419,15 +537,16 @@ int main(int argc, char* argv[]) {
     const auto bytes = static_cast<std::size_t>(argc > 5 ? std::stoull(argv[5]) : 4096);
     const auto address = std::string_view(argc > 6 ? argv[6] : "127.0.0.1");
     const auto service = std::string_view(argc > 7 ? argv[7] : "9000");
+    const auto report = std::string_view(argc > 8 ? argv[8] : "");
 
     if (server_backend == "a" && client_backend == "a") {
-      test::test<asio_server, asio_client>(address, service, connections, messages, bytes);
+      test::test<asio_server, asio_client>(address, service, connections, messages, bytes, report);
     } else if (server_backend == "a" && client_backend == "n") {
-      test::test<asio_server, net_client>(address, service, connections, messages, bytes);
+      test::test<asio_server, net_client>(address, service, connections, messages, bytes, report);
     } else if (server_backend == "n" && client_backend == "a") {
-      test::test<net_server, asio_client>(address, service, connections, messages, bytes);
+      test::test<net_server, asio_client>(address, service, connections, messages, bytes, report);
     } else if (server_backend == "n" && client_backend == "n") {
-      test::test<net_server, net_client>(address, service, connections, messages, bytes);
+      test::test<net_server, net_client>(address, service, connections, messages, bytes, report);
     } else {
       test::usage();
     }